@@ -7,6 +7,13 @@
 #include <time.h>
 #include <unistd.h>
 
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE SerialPortHandle;
+#else
+typedef int SerialPortHandle;
+#endif
+
 #define RED     "\033[1;31m"
 #define GREEN   "\033[1;32m"
 #define YELLOW  "\033[1;33m"
@@ -39,24 +46,22 @@ typedef struct {
     int player1_guess;
     int player2_guess;
     int correct_answer;
+    int player1_time_ms;
+    int player2_time_ms;
+    int player1_points;
+    int player2_points;
     Song song;
+    Song other_song;
 } RoundResult;
 
-GameState game_state = {
-    .current_round = 0,
-    .total_rounds = 3,
-    .player1_score = 0,
-    .player2_score = 0,
-    .melody_duration = 10000,
-    .difficulty_level = 1
-};
+extern GameState game_state;
 
 // functions i need
 void load_song_database(void);
 Song select_random_song(void);
 void send_to_arduino(const char *message);
 int read_from_arduino(char *buffer, int size, int timeout_seconds);
-int serial_port;
+extern SerialPortHandle serial_port;
 
 // for the menu
 void display_main_menu(void);
@@ -75,6 +80,7 @@ void process_round_data(RoundResult *result);
 void change_difficulty(void);
 void view_settings(void);
 void reset_game(void);
+void clear_highscores(void);
 void display_scoreboard(void);
 
 # endif
\ No newline at end of file